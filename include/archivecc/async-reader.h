@@ -0,0 +1,80 @@
+/*
+   Copyright (c) 2019 Andreas Fett
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are met:
+
+   * Redistributions of source code must retain the above copyright notice, this
+     list of conditions and the following disclaimer.
+
+   * Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef ARCHIVECC_ASYNC_READER_H
+#define ARCHIVECC_ASYNC_READER_H
+
+#include <memory>
+
+#include <archivecc/entry.h>
+#include <archivecc/error.h>
+#include <archivecc/reader.h>
+
+namespace archivecc {
+
+// Drives a Reader on a separate stack so that it can be suspended
+// whenever libarchive runs out of input, instead of blocking in the
+// read callback. Each operation returns NEED_INPUT until it has been
+// given enough data through feed() and resume(), and DONE once its
+// result() is available. Only one operation may be pending at a time.
+//
+// The Reader's read callback is taken over by the AsyncReader, the
+// Reader must not be used directly once the AsyncReader is created.
+// Creating it on a Reader that has already been opened throws
+// std::logic_error and leaves the Reader untouched.
+// Destroying the AsyncReader fails a pending operation and leaves
+// the Reader with a read callback that always fails, so the Reader
+// should be discarded along with it.
+class AsyncReader {
+public:
+	using ptr = std::shared_ptr<AsyncReader>;
+
+	enum class State {
+		DONE,
+		NEED_INPUT,
+	};
+
+	virtual State open() = 0;
+	virtual State next_header(Entry::ptr const&) = 0;
+	virtual State read_data_block(const void **, size_t *, int64_t *) = 0;
+	virtual State skip_data() = 0;
+	virtual State close() = 0;
+
+	// The buffer passed to feed() must stay valid until the next
+	// NEED_INPUT. A size of 0 signals the end of the input, fail()
+	// makes the pending read fail.
+	virtual void feed(const void *, size_t) = 0;
+	virtual void fail() = 0;
+	virtual State resume() = 0;
+
+	virtual Error result() const = 0;
+
+	static ptr create(Reader::ptr const&, size_t stack_size = 512 * 1024);
+	virtual ~AsyncReader();
+};
+
+}
+
+#endif
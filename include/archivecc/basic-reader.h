@@ -0,0 +1,262 @@
+/*
+   Copyright (c) 2019 Andreas Fett
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are met:
+
+   * Redistributions of source code must retain the above copyright notice, this
+     list of conditions and the following disclaimer.
+
+   * Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef ARCHIVECC_BASIC_READER_H
+#define ARCHIVECC_BASIC_READER_H
+
+#include <archive.h>
+#include <archive_entry.h>
+#include <new>
+#include <string>
+
+#include <archivecc/error.h>
+
+namespace archivecc {
+
+// Header only reader with the supported formats, filters and the
+// input source fixed at compile time, e.g.
+//
+//     BasicReader<source::File, Formats<format::Tar>, Filters<filter::Gzip>>
+//
+// All calls go straight to libarchive and only the listed format
+// and filter handlers are referenced, so a static libarchive only
+// links those in. Users need libarchive only, not libarchivecc.
+
+namespace detail {
+
+// ARCHIVE_WARN is not a failure, e.g. a filter falling back to an
+// external program. Keep going and return the worst result.
+inline int worst(int l, int r)
+{
+	return l < r ? l : r;
+}
+
+template <typename... Handlers>
+struct SupportAll;
+
+template <>
+struct SupportAll<> {
+	static int apply(archive *)
+	{
+		return ARCHIVE_OK;
+	}
+};
+
+template <typename Handler, typename... Handlers>
+struct SupportAll<Handler, Handlers...> {
+	static int apply(archive *ar)
+	{
+		int res = Handler::support(ar);
+		return res < ARCHIVE_WARN ? res : worst(res, SupportAll<Handlers...>::apply(ar));
+	}
+};
+
+}
+
+template <typename... Handlers>
+struct Formats : detail::SupportAll<Handlers...> { };
+
+template <typename... Handlers>
+struct Filters : detail::SupportAll<Handlers...> { };
+
+#define ARCHIVECC_HANDLER(name, fn)                \
+	struct name {                              \
+		static int support(archive *ar)    \
+		{                                  \
+			return fn(ar);             \
+		}                                  \
+	};
+
+namespace format {
+
+ARCHIVECC_HANDLER(SevenZip, archive_read_support_format_7zip)
+ARCHIVECC_HANDLER(All, archive_read_support_format_all)
+ARCHIVECC_HANDLER(Ar, archive_read_support_format_ar)
+ARCHIVECC_HANDLER(Cab, archive_read_support_format_cab)
+ARCHIVECC_HANDLER(Cpio, archive_read_support_format_cpio)
+ARCHIVECC_HANDLER(Empty, archive_read_support_format_empty)
+ARCHIVECC_HANDLER(Gnutar, archive_read_support_format_gnutar)
+ARCHIVECC_HANDLER(Iso9660, archive_read_support_format_iso9660)
+ARCHIVECC_HANDLER(Lha, archive_read_support_format_lha)
+ARCHIVECC_HANDLER(Mtree, archive_read_support_format_mtree)
+ARCHIVECC_HANDLER(Rar, archive_read_support_format_rar)
+ARCHIVECC_HANDLER(Raw, archive_read_support_format_raw)
+ARCHIVECC_HANDLER(Tar, archive_read_support_format_tar)
+ARCHIVECC_HANDLER(Warc, archive_read_support_format_warc)
+ARCHIVECC_HANDLER(Xar, archive_read_support_format_xar)
+ARCHIVECC_HANDLER(Zip, archive_read_support_format_zip)
+ARCHIVECC_HANDLER(ZipStreamable, archive_read_support_format_zip_streamable)
+ARCHIVECC_HANDLER(ZipSeekable, archive_read_support_format_zip_seekable)
+
+}
+
+namespace filter {
+
+ARCHIVECC_HANDLER(All, archive_read_support_filter_all)
+ARCHIVECC_HANDLER(Bzip2, archive_read_support_filter_bzip2)
+ARCHIVECC_HANDLER(Compress, archive_read_support_filter_compress)
+ARCHIVECC_HANDLER(Gzip, archive_read_support_filter_gzip)
+ARCHIVECC_HANDLER(Grzip, archive_read_support_filter_grzip)
+ARCHIVECC_HANDLER(Lrzip, archive_read_support_filter_lrzip)
+ARCHIVECC_HANDLER(Lz4, archive_read_support_filter_lz4)
+ARCHIVECC_HANDLER(Lzip, archive_read_support_filter_lzip)
+ARCHIVECC_HANDLER(Lzma, archive_read_support_filter_lzma)
+ARCHIVECC_HANDLER(Lzop, archive_read_support_filter_lzop)
+ARCHIVECC_HANDLER(Rpm, archive_read_support_filter_rpm)
+ARCHIVECC_HANDLER(Uu, archive_read_support_filter_uu)
+ARCHIVECC_HANDLER(Xz, archive_read_support_filter_xz)
+
+}
+
+#undef ARCHIVECC_HANDLER
+
+namespace source {
+
+class File {
+public:
+	explicit File(std::string const& filename, size_t block_size = 10240)
+	:
+		filename_(filename),
+		block_size_(block_size)
+	{ }
+
+	int open(archive *ar) const
+	{
+		return archive_read_open_filename(ar, filename_.c_str(), block_size_);
+	}
+
+private:
+	std::string filename_;
+	size_t block_size_;
+};
+
+class Fd {
+public:
+	explicit Fd(int fd, size_t block_size = 10240)
+	:
+		fd_(fd),
+		block_size_(block_size)
+	{ }
+
+	int open(archive *ar) const
+	{
+		return archive_read_open_fd(ar, fd_, block_size_);
+	}
+
+private:
+	int fd_;
+	size_t block_size_;
+};
+
+class Memory {
+public:
+	Memory(const void *buff, size_t size)
+	:
+		buff_(buff),
+		size_(size)
+	{ }
+
+	int open(archive *ar) const
+	{
+		return archive_read_open_memory(ar, buff_, size_);
+	}
+
+private:
+	const void *buff_;
+	size_t size_;
+};
+
+}
+
+template <typename Source, typename FormatList, typename FilterList = Filters<>>
+class BasicReader {
+public:
+	BasicReader()
+	:
+		ar_(archive_read_new()),
+		entry_(archive_entry_new2(ar_))
+	{
+		if (ar_ == nullptr || entry_ == nullptr) {
+			archive_entry_free(entry_);
+			archive_read_free(ar_);
+			throw std::bad_alloc();
+		}
+	}
+
+	BasicReader(BasicReader const&) = delete;
+	BasicReader & operator=(BasicReader const&) = delete;
+
+	~BasicReader()
+	{
+		archive_entry_free(entry_);
+		archive_read_free(ar_);
+	}
+
+	Error open(Source const& source)
+	{
+		int res = FormatList::apply(ar_);
+		if (res >= ARCHIVE_WARN) {
+			res = detail::worst(res, FilterList::apply(ar_));
+		}
+		if (res >= ARCHIVE_WARN) {
+			res = detail::worst(res, source.open(ar_));
+		}
+		return Error(res);
+	}
+
+	// The entry is reused for every header.
+	Error next_header()
+	{
+		return Error(archive_read_next_header2(ar_, entry_));
+	}
+
+	archive_entry *entry() const noexcept
+	{
+		return entry_;
+	}
+
+	Error read_data_block(const void **buff, size_t *size, int64_t *offset)
+	{
+		return Error(archive_read_data_block(ar_, buff, size, offset));
+	}
+
+	Error skip_data()
+	{
+		return Error(archive_read_data_skip(ar_));
+	}
+
+	Error close()
+	{
+		return Error(archive_read_close(ar_));
+	}
+
+private:
+	archive *ar_;
+	archive_entry *entry_;
+};
+
+}
+
+#endif
@@ -0,0 +1,78 @@
+/*
+   Copyright (c) 2019 Andreas Fett
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are met:
+
+   * Redistributions of source code must retain the above copyright notice, this
+     list of conditions and the following disclaimer.
+
+   * Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef ARCHIVECC_BLOCK_CACHE_H
+#define ARCHIVECC_BLOCK_CACHE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace archivecc {
+
+// Size bounded LRU cache of decompressed data blocks which can be
+// shared by Readers in different threads. The cache is split into
+// independently locked shards to keep lookups from contending.
+class BlockCache {
+public:
+	using ptr = std::shared_ptr<BlockCache>;
+
+	// A block is stored under the logical offset at which the
+	// previous block of the member ended. Its own offset can be
+	// larger if there is a hole in between.
+	struct Key {
+		std::string archive;
+		uint64_t member;
+		int64_t offset;
+	};
+
+	struct Block {
+		int64_t offset;
+		bool eof;
+		std::vector<char> data;
+	};
+
+	using block_ptr = std::shared_ptr<const Block>;
+
+	struct Stats {
+		uint64_t hits;
+		uint64_t misses;
+		uint64_t evictions;
+		size_t size;
+	};
+
+	virtual block_ptr lookup(Key const&) = 0;
+	virtual void insert(Key const&, block_ptr const&) = 0;
+	virtual void clear() = 0;
+	virtual Stats stats() const = 0;
+
+	static ptr create(size_t capacity, size_t shards = 16);
+	virtual ~BlockCache();
+};
+
+}
+
+#endif
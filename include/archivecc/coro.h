@@ -0,0 +1,216 @@
+/*
+   Copyright (c) 2019 Andreas Fett
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are met:
+
+   * Redistributions of source code must retain the above copyright notice, this
+     list of conditions and the following disclaimer.
+
+   * Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef ARCHIVECC_CORO_H
+#define ARCHIVECC_CORO_H
+
+#if !defined(__cpp_impl_coroutine) || __cplusplus < 202002L
+#error "archivecc/coro.h requires C++20 coroutines"
+#endif
+
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <utility>
+#include <vector>
+
+#include <archivecc/async-reader.h>
+
+namespace archivecc {
+
+// Lazily started task, the awaiting coroutine is resumed when it
+// finishes.
+template <typename T>
+class Task {
+public:
+	struct promise_type;
+	using handle = std::coroutine_handle<promise_type>;
+
+	struct promise_type {
+		T value{};
+		std::exception_ptr exception;
+		std::coroutine_handle<> continuation;
+
+		Task get_return_object() noexcept
+		{
+			return Task(handle::from_promise(*this));
+		}
+
+		std::suspend_always initial_suspend() noexcept
+		{
+			return {};
+		}
+
+		struct final_awaiter {
+			bool await_ready() noexcept
+			{
+				return false;
+			}
+
+			std::coroutine_handle<> await_suspend(handle h) noexcept
+			{
+				auto c = h.promise().continuation;
+				return c ? c : std::noop_coroutine();
+			}
+
+			void await_resume() noexcept
+			{ }
+		};
+
+		final_awaiter final_suspend() noexcept
+		{
+			return {};
+		}
+
+		void return_value(T v)
+		{
+			value = std::move(v);
+		}
+
+		void unhandled_exception() noexcept
+		{
+			exception = std::current_exception();
+		}
+	};
+
+	Task(Task && other) noexcept
+	:
+		h_(std::exchange(other.h_, {}))
+	{ }
+
+	Task(Task const&) = delete;
+	Task & operator=(Task const&) = delete;
+
+	~Task()
+	{
+		if (h_) {
+			h_.destroy();
+		}
+	}
+
+	bool await_ready() const noexcept
+	{
+		return false;
+	}
+
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<> c) noexcept
+	{
+		h_.promise().continuation = c;
+		return h_;
+	}
+
+	T await_resume()
+	{
+		if (h_.promise().exception) {
+			std::rethrow_exception(h_.promise().exception);
+		}
+		return std::move(h_.promise().value);
+	}
+
+private:
+	explicit Task(handle h) noexcept
+	:
+		h_(h)
+	{ }
+
+	handle h_;
+};
+
+struct Block {
+	Error error;
+	const void *buff = nullptr;
+	size_t size = 0;
+	int64_t offset = 0;
+};
+
+// Awaitable front end for AsyncReader. Source must provide
+//
+//     Awaitable<ssize_t> read(void *, size_t);
+//
+// returning the number of bytes read, 0 at the end of the input and
+// a negative value on error. The Source must outlive the CoReader.
+template <typename Source>
+class CoReader {
+public:
+	CoReader(AsyncReader::ptr const& reader, Source & source, size_t buffer_size = 64 * 1024)
+	:
+		reader_(reader),
+		source_(source),
+		buffer_(buffer_size)
+	{ }
+
+	Task<Error> open()
+	{
+		co_return co_await complete(reader_->open());
+	}
+
+	Task<Error> next_header(Entry::ptr entry)
+	{
+		co_return co_await complete(reader_->next_header(entry));
+	}
+
+	Task<Block> read_block()
+	{
+		Block block;
+		auto state = reader_->read_data_block(&block.buff, &block.size, &block.offset);
+		block.error = co_await complete(state);
+		co_return block;
+	}
+
+	Task<Error> skip_data()
+	{
+		co_return co_await complete(reader_->skip_data());
+	}
+
+	Task<Error> close()
+	{
+		co_return co_await complete(reader_->close());
+	}
+
+private:
+	// libarchive is done with the previous input once it asks for
+	// more, so a single buffer is enough
+	Task<Error> complete(AsyncReader::State state)
+	{
+		while (state == AsyncReader::State::NEED_INPUT) {
+			auto res = co_await source_.read(buffer_.data(), buffer_.size());
+			if (res < 0) {
+				reader_->fail();
+			} else {
+				reader_->feed(buffer_.data(), res);
+			}
+			state = reader_->resume();
+		}
+		co_return reader_->result();
+	}
+
+	AsyncReader::ptr reader_;
+	Source & source_;
+	std::vector<char> buffer_;
+};
+
+}
+
+#endif
@@ -26,8 +26,14 @@
 #ifndef ARCHIVECC_ERROR_H
 #define ARCHIVECC_ERROR_H
 
+#include <stdexcept>
+#include <string>
+
 namespace archivecc {
 
+// Inline, so that the header only BasicReader needs no library.
+// The values are libarchive's ARCHIVE_* codes, which error.cc
+// checks against archive.h.
 class Error {
 public:
 	enum class Code {
@@ -39,13 +45,38 @@ public:
 		FATAL,
 	};
 
-	Error();
-	explicit Error(int);
+	Error() = default;
+
+	inline explicit Error(int code)
+	:
+		code_(error_code(code))
+	{ }
+
+	inline explicit operator bool() const noexcept
+	{
+		return code_ != Code::OK;
+	}
 
-	explicit operator bool() const noexcept;
-	Code code() const noexcept;
+	inline Code code() const noexcept
+	{
+		return code_;
+	}
 
 private:
+	static inline Code error_code(int code)
+	{
+		switch (code) {
+		case 1: return Code::AEOF;
+		case 0: return Code::OK;
+		case -10: return Code::RETRY;
+		case -20: return Code::WARN;
+		case -25: return Code::FAILED;
+		case -30: return Code::FATAL;
+		}
+
+		throw std::logic_error(std::string("unknown error:") + std::to_string(code));
+	}
+
 	Code code_ = Code::OK;
 };
 
@@ -0,0 +1,108 @@
+/*
+   Copyright (c) 2019 Andreas Fett
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are met:
+
+   * Redistributions of source code must retain the above copyright notice, this
+     list of conditions and the following disclaimer.
+
+   * Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef ARCHIVECC_MANIFEST_H
+#define ARCHIVECC_MANIFEST_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <archivecc/error.h>
+
+namespace archivecc {
+
+enum class FileType : uint8_t {
+	UNKNOWN,
+	REGULAR,
+	DIRECTORY,
+	SYMLINK,
+	CHARACTER,
+	BLOCK,
+	FIFO,
+	SOCKET,
+};
+
+// Read-only columnar view of an archive listing. Paths are stored
+// NUL terminated in a single arena, all other columns are arrays
+// indexed by member number. A view does not own its memory.
+class ManifestView {
+public:
+	ManifestView();
+
+	size_t count() const noexcept;
+
+	const char *path(size_t) const noexcept;
+	const int64_t *sizes() const noexcept;
+	const int64_t *mtimes() const noexcept;
+	const int64_t *offsets() const noexcept;
+	const uint32_t *modes() const noexcept;
+	const FileType *types() const noexcept;
+
+	// Point the view at a buffer written by Manifest::save(),
+	// e.g. an mmapped file. The buffer must be 8 byte aligned.
+	Error load(const void *, size_t);
+
+private:
+	friend class Manifest;
+
+	size_t count_ = 0;
+	const uint64_t *path_offsets_ = nullptr;
+	const char *paths_ = nullptr;
+	const int64_t *sizes_ = nullptr;
+	const int64_t *mtimes_ = nullptr;
+	const int64_t *offsets_ = nullptr;
+	const uint32_t *modes_ = nullptr;
+	const FileType *types_ = nullptr;
+};
+
+// Owning manifest as filled by Reader::list(). Offsets are the
+// positions of the member headers in the uncompressed archive stream.
+class Manifest {
+public:
+	void clear() noexcept;
+	void reserve(size_t);
+	void append(const char *path, int64_t size, int64_t mtime, int64_t offset, uint32_t mode, FileType);
+
+	size_t count() const noexcept;
+	ManifestView view() const noexcept;
+
+	// Write the manifest in the flat, host endian format accepted
+	// by ManifestView::load().
+	Error save(int) const;
+
+private:
+	std::vector<uint64_t> path_offsets_;
+	std::vector<char> paths_;
+	std::vector<int64_t> sizes_;
+	std::vector<int64_t> mtimes_;
+	std::vector<int64_t> offsets_;
+	std::vector<uint32_t> modes_;
+	std::vector<FileType> types_;
+};
+
+}
+
+#endif
@@ -26,10 +26,17 @@
 #ifndef ARCHIVECC_READER_H
 #define ARCHIVECC_READER_H
 
+#include <chrono>
+#include <cstdint>
+#include <functional>
 #include <memory>
+#include <string>
+#include <vector>
 
+#include <archivecc/block-cache.h>
 #include <archivecc/entry.h>
 #include <archivecc/error.h>
+#include <archivecc/manifest.h>
 
 namespace archivecc {
 
@@ -97,11 +104,64 @@ public:
 	virtual Error open_memory(const void *, size_t) = 0;
 	virtual Error open_fd(int, size_t) = 0;
 
+	// Read the files in order as a single archive split into volumes.
+	virtual Error open_filenames(std::vector<std::string> const&, size_t) = 0;
+
+	// True once one of the open functions has been called, callbacks
+	// can not be changed any more from then on.
+	virtual bool is_open() const noexcept = 0;
+
 	virtual Error close() = 0;
 
 	virtual Entry::ptr create_entry() = 0;
 	virtual Error next_header(Entry::ptr const&) = 0;
 
+	// Sparse entries are returned as a sequence of blocks with
+	// increasing offsets, the gaps between them are holes.
+	virtual Error read_data_block(const void **, size_t *, int64_t *) = 0;
+	virtual Error skip_data() = 0;
+
+	// Copy the current entry's data to fd, starting at its current
+	// offset. Holes, and whole 4 KiB runs of zero bytes, are seeked over
+	// instead of written only if fd is a regular file and the range lies
+	// beyond the file's size at the start of the call. Anywhere else,
+	// e.g. in block devices, pipes or over existing file contents,
+	// zeros are written.
+	virtual Error read_data_into_fd(int) = 0;
+
+	// Serve data blocks of members already read under the same archive
+	// id from the cache and add newly read ones. Members are identified
+	// by their index, so the archive id must name the exact same file.
+	// A hit saves decoding the member's data, the data may still have
+	// to be decoded to skip over it if the format is not seekable.
+	virtual void set_block_cache(BlockCache::ptr const&, std::string const&) = 0;
+
+	// Caps for reading untrusted input, 0 disables a cap. The ratio is
+	// data decoded by libarchive over compressed input and is checked
+	// once 1 MiB has been decoded, blocks served from a block cache
+	// count towards the output cap only. The time budget starts with
+	// set_limits(). When a cap is exceeded the current and all further
+	// operations fail with FATAL. With limits set, skipped data that
+	// libarchive would have to decode anyway, e.g. behind a compression
+	// filter, is decoded block by block so that it counts against the
+	// caps as well. Members of seekable formats are still seeked over.
+	// The caps are checked after every header and data block and before
+	// every read of input, so a single long running libarchive call is
+	// interrupted as well. For this open_filename(), open_fd() and
+	// open_memory() replace any callbacks set before when limits are set,
+	// so set_limits() has to be called before opening.
+	struct Limits {
+		uint64_t max_entries = 0;
+		uint64_t max_output = 0;
+		double max_ratio = 0;
+		std::chrono::milliseconds max_time{0};
+	};
+
+	virtual void set_limits(Limits const&) = 0;
+
+	// Append all remaining members to the manifest, skipping their data.
+	virtual Error list(Manifest &) = 0;
+
 	static ptr create();
 	virtual ~Reader();
 };
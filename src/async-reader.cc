@@ -0,0 +1,222 @@
+/*
+   Copyright (c) 2019 Andreas Fett. All rights reserved.
+   Use of this source code is governed by a BSD-style
+   license that can be found in the LICENSE file.
+*/
+
+#include <archivecc/async-reader.h>
+
+#include <exception>
+#include <stdexcept>
+#include <ucontext.h>
+
+namespace archivecc {
+
+class AsyncReaderImpl : public AsyncReader {
+public:
+	AsyncReaderImpl(Reader::ptr const&, size_t);
+	~AsyncReaderImpl();
+
+	State open() override;
+	State next_header(Entry::ptr const&) override;
+	State read_data_block(const void **, size_t *, int64_t *) override;
+	State skip_data() override;
+	State close() override;
+
+	void feed(const void *, size_t) override;
+	void fail() override;
+	State resume() override;
+
+	Error result() const override;
+
+private:
+	using operation = std::function<Error(void)>;
+
+	State start(operation const&);
+	State run();
+	ssize_t read(const void **);
+	static void fiber_main();
+
+	Reader::ptr reader_;
+	// shared with the reader's read callback, cleared on destruction
+	std::shared_ptr<AsyncReaderImpl*> link_;
+	std::unique_ptr<char[]> stack_;
+	size_t stack_size_;
+	ucontext_t caller_;
+	ucontext_t fiber_;
+	bool started_ = false;
+	operation op_;
+	Error result_;
+	std::exception_ptr exception_;
+	bool have_input_ = false;
+	const void *input_ = nullptr;
+	ssize_t input_size_ = 0;
+
+	static thread_local AsyncReaderImpl *starting_;
+};
+
+thread_local AsyncReaderImpl *AsyncReaderImpl::starting_ = nullptr;
+
+AsyncReaderImpl::AsyncReaderImpl(Reader::ptr const& reader, size_t stack_size)
+:
+	reader_(reader),
+	link_(std::make_shared<AsyncReaderImpl*>(this)),
+	stack_(new char[stack_size]),
+	stack_size_(stack_size)
+{
+	if (reader_->is_open()) {
+		throw std::logic_error("AsyncReader: reader is already open");
+	}
+
+	auto link = link_;
+	auto err = reader_->set_read_callback([link](const void **buff) -> ssize_t {
+		return *link ? (*link)->read(buff) : -1;
+	});
+	if (err) {
+		throw std::logic_error("AsyncReader: failed to set read callback");
+	}
+}
+
+AsyncReaderImpl::~AsyncReaderImpl()
+{
+	// unwind a pending operation by failing all of its reads,
+	// afterwards the fiber holds no more frames but fiber_main's
+	while (op_) {
+		input_ = nullptr;
+		input_size_ = -1;
+		have_input_ = true;
+		swapcontext(&caller_, &fiber_);
+	}
+
+	// the reader's callback fails from now on
+	*link_ = nullptr;
+}
+
+void AsyncReaderImpl::fiber_main()
+{
+	auto self = starting_;
+	for (;;) {
+		try {
+			self->result_ = self->op_();
+		} catch (...) {
+			self->exception_ = std::current_exception();
+		}
+		self->op_ = nullptr;
+		swapcontext(&self->fiber_, &self->caller_);
+	}
+}
+
+AsyncReader::State AsyncReaderImpl::start(operation const& op)
+{
+	if (op_) {
+		throw std::logic_error("AsyncReader: operation already pending");
+	}
+	op_ = op;
+
+	if (!started_) {
+		getcontext(&fiber_);
+		fiber_.uc_stack.ss_sp = stack_.get();
+		fiber_.uc_stack.ss_size = stack_size_;
+		fiber_.uc_link = nullptr;
+		makecontext(&fiber_, fiber_main, 0);
+		starting_ = this;
+		started_ = true;
+	}
+
+	return run();
+}
+
+AsyncReader::State AsyncReaderImpl::run()
+{
+	swapcontext(&caller_, &fiber_);
+	if (exception_) {
+		auto e = exception_;
+		exception_ = nullptr;
+		std::rethrow_exception(e);
+	}
+	return op_ ? State::NEED_INPUT : State::DONE;
+}
+
+// called on the fiber from inside libarchive
+ssize_t AsyncReaderImpl::read(const void **buff)
+{
+	if (!have_input_) {
+		swapcontext(&fiber_, &caller_);
+	}
+	have_input_ = false;
+	*buff = input_;
+	return input_size_;
+}
+
+AsyncReader::State AsyncReaderImpl::open()
+{
+	return start([this]() {
+		return reader_->open();
+	});
+}
+
+AsyncReader::State AsyncReaderImpl::next_header(Entry::ptr const& entry)
+{
+	return start([this, entry]() {
+		return reader_->next_header(entry);
+	});
+}
+
+AsyncReader::State AsyncReaderImpl::read_data_block(const void **buff, size_t *size, int64_t *offset)
+{
+	return start([this, buff, size, offset]() {
+		return reader_->read_data_block(buff, size, offset);
+	});
+}
+
+AsyncReader::State AsyncReaderImpl::skip_data()
+{
+	return start([this]() {
+		return reader_->skip_data();
+	});
+}
+
+AsyncReader::State AsyncReaderImpl::close()
+{
+	return start([this]() {
+		return reader_->close();
+	});
+}
+
+void AsyncReaderImpl::feed(const void *buff, size_t size)
+{
+	if (have_input_) {
+		throw std::logic_error("AsyncReader: input already pending");
+	}
+	input_ = buff;
+	input_size_ = size;
+	have_input_ = true;
+}
+
+void AsyncReaderImpl::fail()
+{
+	feed(nullptr, 0);
+	input_size_ = -1;
+}
+
+AsyncReader::State AsyncReaderImpl::resume()
+{
+	if (!op_ || !have_input_) {
+		throw std::logic_error("AsyncReader: nothing to resume");
+	}
+	return run();
+}
+
+Error AsyncReaderImpl::result() const
+{
+	return result_;
+}
+
+AsyncReader::ptr AsyncReader::create(Reader::ptr const& reader, size_t stack_size)
+{
+	return std::make_shared<AsyncReaderImpl>(reader, stack_size);
+}
+
+AsyncReader::~AsyncReader() = default;
+
+}
@@ -0,0 +1,158 @@
+/*
+   Copyright (c) 2019 Andreas Fett. All rights reserved.
+   Use of this source code is governed by a BSD-style
+   license that can be found in the LICENSE file.
+*/
+
+#include <archivecc/block-cache.h>
+
+#include <list>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace {
+
+using Key = archivecc::BlockCache::Key;
+
+struct KeyHash {
+	size_t operator()(Key const& key) const noexcept
+	{
+		size_t h = std::hash<std::string>()(key.archive);
+		h ^= std::hash<uint64_t>()(key.member) + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+		h ^= std::hash<int64_t>()(key.offset) + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+		return h;
+	}
+};
+
+struct KeyEqual {
+	bool operator()(Key const& l, Key const& r) const noexcept
+	{
+		return l.member == r.member && l.offset == r.offset && l.archive == r.archive;
+	}
+};
+
+// rough per block bookkeeping cost, so that tiny blocks still count
+const size_t block_overhead = 128;
+
+}
+
+namespace archivecc {
+
+class BlockCacheImpl : public BlockCache {
+public:
+	BlockCacheImpl(size_t, size_t);
+
+	block_ptr lookup(Key const&) override;
+	void insert(Key const&, block_ptr const&) override;
+	void clear() override;
+	Stats stats() const override;
+
+private:
+	struct Shard {
+		using lru_list = std::list<std::pair<Key, block_ptr>>;
+
+		mutable std::mutex mutex;
+		lru_list lru;
+		std::unordered_map<Key, lru_list::iterator, KeyHash, KeyEqual> map;
+		size_t size = 0;
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+		uint64_t evictions = 0;
+	};
+
+	Shard & shard(Key const&);
+
+	size_t shard_capacity_;
+	std::vector<Shard> shards_;
+};
+
+BlockCacheImpl::BlockCacheImpl(size_t capacity, size_t shards)
+:
+	shard_capacity_(shards ? capacity / shards : 0),
+	shards_(shards)
+{
+	if (shards == 0) {
+		throw std::logic_error("BlockCache: need at least one shard");
+	}
+}
+
+BlockCacheImpl::Shard & BlockCacheImpl::shard(Key const& key)
+{
+	return shards_[KeyHash()(key) % shards_.size()];
+}
+
+BlockCache::block_ptr BlockCacheImpl::lookup(Key const& key)
+{
+	auto & s = shard(key);
+	std::lock_guard<std::mutex> lock(s.mutex);
+	auto it = s.map.find(key);
+	if (it == s.map.end()) {
+		++s.misses;
+		return nullptr;
+	}
+	++s.hits;
+	s.lru.splice(s.lru.begin(), s.lru, it->second);
+	return it->second->second;
+}
+
+void BlockCacheImpl::insert(Key const& key, block_ptr const& block)
+{
+	size_t cost = block->data.size() + block_overhead;
+	if (cost > shard_capacity_) {
+		return;
+	}
+
+	auto & s = shard(key);
+	std::lock_guard<std::mutex> lock(s.mutex);
+	auto it = s.map.find(key);
+	if (it != s.map.end()) {
+		s.size -= it->second->second->data.size() + block_overhead;
+		s.lru.erase(it->second);
+		s.map.erase(it);
+	}
+
+	while (s.size + cost > shard_capacity_) {
+		auto & last = s.lru.back();
+		s.size -= last.second->data.size() + block_overhead;
+		s.map.erase(last.first);
+		s.lru.pop_back();
+		++s.evictions;
+	}
+
+	s.lru.emplace_front(key, block);
+	s.map.emplace(key, s.lru.begin());
+	s.size += cost;
+}
+
+void BlockCacheImpl::clear()
+{
+	for (auto & s : shards_) {
+		std::lock_guard<std::mutex> lock(s.mutex);
+		s.map.clear();
+		s.lru.clear();
+		s.size = 0;
+	}
+}
+
+BlockCache::Stats BlockCacheImpl::stats() const
+{
+	Stats stats = {};
+	for (auto & s : shards_) {
+		std::lock_guard<std::mutex> lock(s.mutex);
+		stats.hits += s.hits;
+		stats.misses += s.misses;
+		stats.evictions += s.evictions;
+		stats.size += s.size;
+	}
+	return stats;
+}
+
+BlockCache::ptr BlockCache::create(size_t capacity, size_t shards)
+{
+	return std::make_shared<BlockCacheImpl>(capacity, shards);
+}
+
+BlockCache::~BlockCache() = default;
+
+}
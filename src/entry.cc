@@ -52,7 +52,7 @@ public:
 	Entry::ptr create_entry() const override;
 };
 
-Entry::ptr EntryFactory::create_entry() const
+Entry::ptr EntryFactoryImpl::create_entry() const
 {
 	return Entry::create();
 }
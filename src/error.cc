@@ -7,46 +7,11 @@
 #include <archivecc/error.h>
 
 #include <archive.h>
-#include <stdexcept>
 
-namespace {
-
-archivecc::Error::Code error_code(int code)
-{
-	using namespace ::archivecc;
-
-	switch (code) {
-	case ARCHIVE_EOF: return Error::Code::AEOF;
-	case ARCHIVE_OK: return Error::Code::OK;
-	case ARCHIVE_RETRY: return Error::Code::RETRY;
-	case ARCHIVE_WARN: return Error::Code::WARN;
-	case ARCHIVE_FAILED: return Error::Code::FAILED;
-	case ARCHIVE_FATAL: return Error::Code::FATAL;
-	}
-
-	throw std::logic_error(std::string("unknown error:") + std::to_string(code));
-	return Error::Code::FATAL;
-}
-
-}
-
-namespace archivecc {
-
-Error::Error() = default;
-
-Error::Error(int code)
-:
-	code_(error_code(code))
-{ }
-
-Error::operator bool() const noexcept
-{
-	return code_ != Code::OK;
-}
-
-Error::Code Error::code() const noexcept
-{
-	return code_;
-}
-
-}
+// Error maps these by value without including archive.h
+static_assert(ARCHIVE_EOF == 1, "ARCHIVE_EOF changed");
+static_assert(ARCHIVE_OK == 0, "ARCHIVE_OK changed");
+static_assert(ARCHIVE_RETRY == -10, "ARCHIVE_RETRY changed");
+static_assert(ARCHIVE_WARN == -20, "ARCHIVE_WARN changed");
+static_assert(ARCHIVE_FAILED == -25, "ARCHIVE_FAILED changed");
+static_assert(ARCHIVE_FATAL == -30, "ARCHIVE_FATAL changed");
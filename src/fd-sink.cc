@@ -0,0 +1,153 @@
+/*
+   Copyright (c) 2019 Andreas Fett. All rights reserved.
+   Use of this source code is governed by a BSD-style
+   license that can be found in the LICENSE file.
+*/
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fd-sink.h"
+
+namespace {
+
+// holes are only punched for zero runs covering whole filesystem blocks
+const size_t granule = 4096;
+
+bool all_zero(const char *p, size_t n)
+{
+	// OR together 64 bytes per iteration, the compiler
+	// turns the inner loop into vector loads
+	uint64_t acc = 0;
+	for (; n >= 64; p += 64, n -= 64) {
+		uint64_t w[8];
+		memcpy(w, p, sizeof(w));
+		for (auto v : w) {
+			acc |= v;
+		}
+		if (acc) {
+			return false;
+		}
+	}
+	for (; n > 0; ++p, --n) {
+		acc |= static_cast<unsigned char>(*p);
+	}
+	return acc == 0;
+}
+
+}
+
+namespace archivecc {
+
+FdSink::FdSink(int fd)
+:
+	fd_(fd),
+	base_(lseek(fd, 0, SEEK_CUR)),
+	seekable_(base_ >= 0),
+	holes_from_(std::numeric_limits<int64_t>::max())
+{
+	struct stat st;
+	if (!seekable_) {
+		base_ = 0;
+	} else if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+		holes_from_ = std::max<int64_t>(st.st_size - base_, 0);
+	}
+}
+
+int FdSink::write_data(const char *p, size_t size, int64_t offset)
+{
+	while (size > 0) {
+		ssize_t r = seekable_
+			? pwrite(fd_, p, size, base_ + offset)
+			: ::write(fd_, p, size);
+		if (r < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		p += r;
+		size -= r;
+		offset += r;
+	}
+	pos_ = offset;
+	return 0;
+}
+
+// zero fill the unwritten range up to offset, as far as it
+// can not be left as a hole
+int FdSink::write_zeros(int64_t offset)
+{
+	static const char zeros[granule] = {};
+	offset = std::min(offset, holes_from_);
+	while (pos_ < offset) {
+		auto n = std::min<int64_t>(offset - pos_, sizeof(zeros));
+		if (write_data(zeros, n, pos_) < 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int FdSink::write(const void *buff, size_t size, int64_t offset)
+{
+	if (offset < pos_) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	end_ = std::max<int64_t>(end_, offset + size);
+	auto p = static_cast<const char*>(buff);
+
+	if (write_zeros(offset) < 0) {
+		return -1;
+	}
+
+	// collect runs of data between zero granules and write them
+	// in one go, the zero granules past holes_from_ are skipped.
+	// Granules are aligned to the file position so that skipped
+	// runs cover whole blocks.
+	size_t run = 0;
+	while (run < size) {
+		size_t n = std::min(granule - (base_ + offset + run) % granule, size - run);
+		if (n != granule || offset + int64_t(run) < holes_from_ || !all_zero(p + run, n)) {
+			run += n;
+			continue;
+		}
+		if (run > 0 && write_data(p, run, offset) < 0) {
+			return -1;
+		}
+		p += run + n;
+		size -= run + n;
+		offset += run + n;
+		run = 0;
+	}
+	return run > 0 ? write_data(p, run, offset) : 0;
+}
+
+int FdSink::finish(int64_t size)
+{
+	end_ = std::max(end_, size);
+	if (write_zeros(end_) < 0) {
+		return -1;
+	}
+
+	// extend the file over a trailing hole by writing its last byte
+	if (pos_ < end_) {
+		static const char zero = 0;
+		if (write_data(&zero, 1, end_ - 1) < 0) {
+			return -1;
+		}
+	}
+
+	if (!seekable_) {
+		return 0;
+	}
+	return lseek(fd_, base_ + end_, SEEK_SET) < 0 ? -1 : 0;
+}
+
+}
@@ -0,0 +1,37 @@
+/*
+   Copyright (c) 2019 Andreas Fett. All rights reserved.
+   Use of this source code is governed by a BSD-style
+   license that can be found in the LICENSE file.
+*/
+
+#include <cstddef>
+#include <cstdint>
+
+namespace archivecc {
+
+// Writes entry data blocks to a file descriptor, preserving holes.
+// Data is written relative to the fd's offset at construction time.
+// Holes and zero runs are only left unwritten in a regular file
+// beyond its size at construction time, everywhere else zeros are
+// written so that stale contents are overwritten. Returns -1 and
+// sets errno on failure.
+class FdSink {
+public:
+	explicit FdSink(int);
+
+	int write(const void *, size_t, int64_t);
+	int finish(int64_t);
+
+private:
+	int write_data(const char *, size_t, int64_t);
+	int write_zeros(int64_t);
+
+	int fd_;
+	int64_t base_;
+	bool seekable_;
+	int64_t holes_from_;
+	int64_t pos_ = 0;
+	int64_t end_ = 0;
+};
+
+}
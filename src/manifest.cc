@@ -0,0 +1,230 @@
+/*
+   Copyright (c) 2019 Andreas Fett. All rights reserved.
+   Use of this source code is governed by a BSD-style
+   license that can be found in the LICENSE file.
+*/
+
+#include <archivecc/manifest.h>
+
+#include <archive.h>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+
+namespace {
+
+// File layout, all sections 8 byte aligned:
+//   magic, count, arena size
+//   path offsets, sizes, mtimes, offsets  (8 bytes * count each)
+//   modes (4 bytes * count), types (1 byte * count)
+//   path arena
+const char magic[8] = { 'A', 'R', 'C', 'C', 'M', 'F', '0', '1' };
+const size_t header_size = sizeof(magic) + 2 * sizeof(uint64_t);
+
+size_t align8(size_t n)
+{
+	return (n + 7) & ~size_t(7);
+}
+
+int write_all(int fd, const void *buff, size_t size)
+{
+	auto p = static_cast<const char*>(buff);
+	while (size > 0) {
+		ssize_t r = write(fd, p, size);
+		if (r < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		p += r;
+		size -= r;
+	}
+	return 0;
+}
+
+int write_padding(int fd, size_t size)
+{
+	static const char zeros[8] = {};
+	return write_all(fd, zeros, align8(size) - size);
+}
+
+}
+
+namespace archivecc {
+
+ManifestView::ManifestView() = default;
+
+size_t ManifestView::count() const noexcept
+{
+	return count_;
+}
+
+const char *ManifestView::path(size_t idx) const noexcept
+{
+	return paths_ + path_offsets_[idx];
+}
+
+const int64_t *ManifestView::sizes() const noexcept
+{
+	return sizes_;
+}
+
+const int64_t *ManifestView::mtimes() const noexcept
+{
+	return mtimes_;
+}
+
+const int64_t *ManifestView::offsets() const noexcept
+{
+	return offsets_;
+}
+
+const uint32_t *ManifestView::modes() const noexcept
+{
+	return modes_;
+}
+
+const FileType *ManifestView::types() const noexcept
+{
+	return types_;
+}
+
+Error ManifestView::load(const void *buff, size_t size)
+{
+	auto p = static_cast<const char*>(buff);
+	if (reinterpret_cast<uintptr_t>(buff) % 8 != 0) {
+		return Error(ARCHIVE_FATAL);
+	}
+	if (size < header_size || memcmp(p, magic, sizeof(magic)) != 0) {
+		return Error(ARCHIVE_FATAL);
+	}
+
+	uint64_t count;
+	uint64_t arena_size;
+	memcpy(&count, p + sizeof(magic), sizeof(count));
+	memcpy(&arena_size, p + sizeof(magic) + sizeof(count), sizeof(arena_size));
+
+	// each member takes at least 37 bytes, this bounds count
+	// before the section sizes are computed
+	size_t avail = size - header_size;
+	if (count > avail / 37 || arena_size > avail) {
+		return Error(ARCHIVE_FATAL);
+	}
+	size_t columns = 4 * 8 * count + align8(4 * count) + align8(count);
+	if (columns + arena_size > avail) {
+		return Error(ARCHIVE_FATAL);
+	}
+
+	p += header_size;
+	auto path_offsets = reinterpret_cast<const uint64_t*>(p);
+	p += 8 * count;
+	auto sizes = reinterpret_cast<const int64_t*>(p);
+	p += 8 * count;
+	auto mtimes = reinterpret_cast<const int64_t*>(p);
+	p += 8 * count;
+	auto offsets = reinterpret_cast<const int64_t*>(p);
+	p += 8 * count;
+	auto modes = reinterpret_cast<const uint32_t*>(p);
+	p += align8(4 * count);
+	auto types = reinterpret_cast<const FileType*>(p);
+	p += align8(count);
+	auto paths = p;
+
+	if (count > 0 && (arena_size == 0 || paths[arena_size - 1] != '\0')) {
+		return Error(ARCHIVE_FATAL);
+	}
+	for (size_t i = 0; i < count; ++i) {
+		if (path_offsets[i] >= arena_size || types[i] > FileType::SOCKET) {
+			return Error(ARCHIVE_FATAL);
+		}
+	}
+
+	count_ = count;
+	path_offsets_ = path_offsets;
+	paths_ = paths;
+	sizes_ = sizes;
+	mtimes_ = mtimes;
+	offsets_ = offsets;
+	modes_ = modes;
+	types_ = types;
+	return Error();
+}
+
+void Manifest::clear() noexcept
+{
+	path_offsets_.clear();
+	paths_.clear();
+	sizes_.clear();
+	mtimes_.clear();
+	offsets_.clear();
+	modes_.clear();
+	types_.clear();
+}
+
+void Manifest::reserve(size_t count)
+{
+	path_offsets_.reserve(count);
+	sizes_.reserve(count);
+	mtimes_.reserve(count);
+	offsets_.reserve(count);
+	modes_.reserve(count);
+	types_.reserve(count);
+}
+
+void Manifest::append(const char *path, int64_t size, int64_t mtime, int64_t offset, uint32_t mode, FileType type)
+{
+	if (path == nullptr) {
+		path = "";
+	}
+	path_offsets_.push_back(paths_.size());
+	paths_.insert(paths_.end(), path, path + strlen(path) + 1);
+	sizes_.push_back(size);
+	mtimes_.push_back(mtime);
+	offsets_.push_back(offset);
+	modes_.push_back(mode);
+	types_.push_back(type);
+}
+
+size_t Manifest::count() const noexcept
+{
+	return types_.size();
+}
+
+ManifestView Manifest::view() const noexcept
+{
+	ManifestView view;
+	view.count_ = count();
+	view.path_offsets_ = path_offsets_.data();
+	view.paths_ = paths_.data();
+	view.sizes_ = sizes_.data();
+	view.mtimes_ = mtimes_.data();
+	view.offsets_ = offsets_.data();
+	view.modes_ = modes_.data();
+	view.types_ = types_.data();
+	return view;
+}
+
+Error Manifest::save(int fd) const
+{
+	uint64_t count = this->count();
+	uint64_t arena_size = paths_.size();
+
+	if (write_all(fd, magic, sizeof(magic)) < 0 ||
+	    write_all(fd, &count, sizeof(count)) < 0 ||
+	    write_all(fd, &arena_size, sizeof(arena_size)) < 0 ||
+	    write_all(fd, path_offsets_.data(), 8 * count) < 0 ||
+	    write_all(fd, sizes_.data(), 8 * count) < 0 ||
+	    write_all(fd, mtimes_.data(), 8 * count) < 0 ||
+	    write_all(fd, offsets_.data(), 8 * count) < 0 ||
+	    write_all(fd, modes_.data(), 4 * count) < 0 ||
+	    write_padding(fd, 4 * count) < 0 ||
+	    write_all(fd, types_.data(), count) < 0 ||
+	    write_padding(fd, count) < 0 ||
+	    write_all(fd, paths_.data(), arena_size) < 0) {
+		return Error(ARCHIVE_FATAL);
+	}
+	return Error();
+}
+
+}
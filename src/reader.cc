@@ -6,10 +6,17 @@
 
 #include <archivecc/reader.h>
 
+#include <algorithm>
 #include <archive.h>
+#include <archive_entry.h>
 #include <cassert>
+#include <cerrno>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "entry-impl.h"
+#include "fd-sink.h"
+#include "volume-set.h"
 
 namespace archivecc {
 
@@ -63,18 +70,40 @@ public:
 	Error open_filename(std::string const&, size_t) override;
 	Error open_memory(const void *, size_t) override;
 	Error open_fd(int, size_t) override;
+	Error open_filenames(std::vector<std::string> const&, size_t) override;
+	bool is_open() const noexcept override;
 
 	Error close() override;
 	Entry::ptr create_entry() override;
 
 	Error next_header(Entry::ptr const&) override;
 
+	Error read_data_block(const void **, size_t *, int64_t *) override;
+	Error skip_data() override;
+	Error read_data_into_fd(int) override;
+
+	Error list(Manifest &) override;
+
+	void set_block_cache(BlockCache::ptr const&, std::string const&) override;
+	void set_limits(Limits const&) override;
+
 private:
 	inline archive *raw() const
 	{
 		return ar_.get();
 	}
 
+	Error open_checked_memory(const void *, size_t);
+	Error open_checked_fd(int, size_t);
+
+	int read_header(archive_entry *);
+	bool skip_decodes(archive_entry *) const;
+	int read_block(const void **, size_t *, int64_t *);
+	int read_cached_block(const void **, size_t *, int64_t *);
+	int decode_block(const void **, size_t *, int64_t *);
+	int drain_data();
+	int check_limits();
+
 	static la_ssize_t read_callback_stub(archive *, void *, const void **);
 	static la_int64_t skip_callback_stub(archive *, void *, la_int64_t);
 	static la_int64_t seek_callback_stub(archive *, void *, la_int64_t, int);
@@ -82,6 +111,8 @@ private:
 	static int open_callback_stub(archive *, void *);
 	static int close_callback_stub(archive *, void *);
 
+	// must outlive ar_, whose close callback still uses it
+	std::unique_ptr<VolumeSet> volumes_;
 	std::unique_ptr<archive, decltype(&archive_read_free)> ar_;
 	read_callback read_cb_;
 	skip_callback skip_cb_;
@@ -89,11 +120,28 @@ private:
 	write_callback write_cb_;
 	open_callback open_cb_;
 	close_callback close_cb_;
+	bool opened_ = false;
+
+	BlockCache::ptr cache_;
+	BlockCache::Key key_;
+	BlockCache::block_ptr block_;
+	int64_t consumed_ = 0;
+
+	Limits limits_;
+	bool limited_ = false;
+	bool exceeded_ = false;
+	bool in_data_ = false;
+	bool drain_ = false;
+	std::chrono::steady_clock::time_point deadline_;
+	uint64_t entries_ = 0;
+	uint64_t output_ = 0;
+	uint64_t decoded_ = 0;
 };
 
 ReaderImpl::ReaderImpl()
 :
-	ar_(archive_read_new(), &archive_read_free)
+	ar_(archive_read_new(), &archive_read_free),
+	key_{std::string(), uint64_t(-1), 0}
 {
 	if (ar_ == nullptr) {
 		throw std::bad_alloc();
@@ -273,6 +321,9 @@ ssize_t ReaderImpl::read_callback_stub(archive *ar, void *data, const void **buf
 {
 	auto self = static_cast<ReaderImpl*>(data);
 	ASSERT_OR_FAIL(ar && self && self->raw() == ar && self->read_cb_);
+	if (self->limited_ && self->check_limits() != ARCHIVE_OK) {
+		return ARCHIVE_FATAL;
+	}
 	return self->read_cb_(buffer);
 }
 
@@ -321,59 +372,229 @@ int ReaderImpl::close_callback_stub(archive *ar, void *data)
 
 Error ReaderImpl::set_open_callback(open_callback const& cb)
 {
-	return Error(archive_read_set_open_callback(raw(),
-		cb ? ReaderImpl::open_callback_stub : nullptr));
+	if (opened_) {
+		return Error(ARCHIVE_FATAL);
+	}
+	int res = archive_read_set_open_callback(raw(),
+		cb ? ReaderImpl::open_callback_stub : nullptr);
+	if (res == ARCHIVE_OK) {
+		open_cb_ = cb;
+	}
+	return Error(res);
 }
 
 Error ReaderImpl::set_read_callback(read_callback const& cb)
 {
-	return Error(archive_read_set_read_callback(raw(),
-		cb ? ReaderImpl::read_callback_stub : nullptr));
+	if (opened_) {
+		return Error(ARCHIVE_FATAL);
+	}
+	int res = archive_read_set_read_callback(raw(),
+		cb ? ReaderImpl::read_callback_stub : nullptr);
+	if (res == ARCHIVE_OK) {
+		read_cb_ = cb;
+	}
+	return Error(res);
 }
 
 Error ReaderImpl::set_seek_callback(seek_callback const& cb)
 {
-	return Error(archive_read_set_seek_callback(raw(),
-		cb ? ReaderImpl::seek_callback_stub : nullptr));
+	if (opened_) {
+		return Error(ARCHIVE_FATAL);
+	}
+	int res = archive_read_set_seek_callback(raw(),
+		cb ? ReaderImpl::seek_callback_stub : nullptr);
+	if (res == ARCHIVE_OK) {
+		seek_cb_ = cb;
+	}
+	return Error(res);
 }
 
 Error ReaderImpl::set_skip_callback(skip_callback const& cb)
 {
-	return Error(archive_read_set_skip_callback(raw(),
-		cb ? ReaderImpl::skip_callback_stub : nullptr));
+	if (opened_) {
+		return Error(ARCHIVE_FATAL);
+	}
+	int res = archive_read_set_skip_callback(raw(),
+		cb ? ReaderImpl::skip_callback_stub : nullptr);
+	if (res == ARCHIVE_OK) {
+		skip_cb_ = cb;
+	}
+	return Error(res);
 }
 
 Error ReaderImpl::set_close_callback(close_callback const& cb)
 {
-	return Error(archive_read_set_close_callback(raw(),
-		cb ? ReaderImpl::close_callback_stub : nullptr));
+	if (opened_) {
+		return Error(ARCHIVE_FATAL);
+	}
+	int res = archive_read_set_close_callback(raw(),
+		cb ? ReaderImpl::close_callback_stub : nullptr);
+	if (res == ARCHIVE_OK) {
+		close_cb_ = cb;
+	}
+	return Error(res);
+}
+
+bool ReaderImpl::is_open() const noexcept
+{
+	return opened_;
 }
 
 Error ReaderImpl::open()
 {
+	opened_ = true;
+	// only set here, the other open functions install their own data
+	archive_read_set_callback_data(raw(), this);
 	return Error(archive_read_open1(raw()));
 }
 
+// With limits set, files, memory and fds are read through our own
+// callbacks so that the limits are checked before every read.
 Error ReaderImpl::open_filename(const char *filename, size_t block_size)
 {
+	if (limited_) {
+		if (filename == nullptr || *filename == '\0') {
+			return open_fd(STDIN_FILENO, block_size);
+		}
+		return open_filenames({filename}, block_size);
+	}
+	opened_ = true;
 	return Error(archive_read_open_filename(raw(), filename, block_size));
 }
 
 Error ReaderImpl::open_filename(std::string const& filename, size_t block_size)
 {
-	return Error(archive_read_open_filename(raw(), filename.c_str(), block_size));
+	return open_filename(filename.c_str(), block_size);
 }
 
 Error ReaderImpl::open_memory(const void *buff, size_t size)
 {
+	if (limited_) {
+		return open_checked_memory(buff, size);
+	}
+	opened_ = true;
 	return Error(archive_read_open_memory(raw(), buff, size));
 }
 
 Error ReaderImpl::open_fd(int fd, size_t block_size)
 {
+	if (limited_) {
+		return open_checked_fd(fd, block_size);
+	}
+	opened_ = true;
 	return Error(archive_read_open_fd(raw(), fd, block_size));
 }
 
+// The buffer is handed out in pieces, so that a long running decode
+// still reaches the check in read_callback_stub() every so often.
+Error ReaderImpl::open_checked_memory(const void *buff, size_t size)
+{
+	struct Memory {
+		const char *data;
+		int64_t size;
+		int64_t pos;
+	};
+	auto mem = std::make_shared<Memory>(Memory{static_cast<const char*>(buff), int64_t(size), 0});
+
+	Error err = set_read_callback([mem](const void **out) -> ssize_t {
+		auto n = std::min<int64_t>(mem->size - mem->pos, 64 * 1024);
+		*out = mem->data + mem->pos;
+		mem->pos += n;
+		return n;
+	});
+	if (!err) {
+		err = set_skip_callback([mem](int64_t request) {
+			auto n = std::min(request, mem->size - mem->pos);
+			mem->pos += n;
+			return n;
+		});
+	}
+	if (!err) {
+		err = set_seek_callback([mem](int64_t offset, Seek whence) -> int64_t {
+			switch (whence) {
+			case Seek::SET: break;
+			case Seek::CUR: offset += mem->pos; break;
+			case Seek::END: offset += mem->size; break;
+			}
+			if (offset < 0 || offset > mem->size) {
+				return ARCHIVE_FATAL;
+			}
+			mem->pos = offset;
+			return offset;
+		});
+	}
+	if (err) {
+		return err;
+	}
+	return open();
+}
+
+// Like archive_read_open_fd(), skips are only done by seeking in
+// regular files, seeks are passed on as they are.
+Error ReaderImpl::open_checked_fd(int fd, size_t block_size)
+{
+	struct File {
+		int fd;
+		bool regular;
+		std::vector<char> buffer;
+	};
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		archive_set_error(raw(), errno, "can't stat fd %d", fd);
+		return Error(ARCHIVE_FATAL);
+	}
+	auto file = std::make_shared<File>(File{fd, S_ISREG(st.st_mode), std::vector<char>(block_size)});
+
+	Error err = set_read_callback([this, file](const void **out) -> ssize_t {
+		ssize_t res;
+		do {
+			res = ::read(file->fd, file->buffer.data(), file->buffer.size());
+		} while (res < 0 && errno == EINTR);
+		if (res < 0) {
+			archive_set_error(raw(), errno, "error reading fd %d", file->fd);
+			return ARCHIVE_FATAL;
+		}
+		*out = file->buffer.data();
+		return res;
+	});
+	if (!err) {
+		err = set_skip_callback([file](int64_t request) -> int64_t {
+			if (!file->regular || lseek(file->fd, request, SEEK_CUR) < 0) {
+				return 0;
+			}
+			return request;
+		});
+	}
+	if (!err) {
+		err = set_seek_callback([this, file](int64_t offset, Seek whence) -> int64_t {
+			int w = whence == Seek::SET ? SEEK_SET : whence == Seek::CUR ? SEEK_CUR : SEEK_END;
+			auto res = lseek(file->fd, offset, w);
+			if (res < 0) {
+				archive_set_error(raw(), errno, "error seeking fd %d", file->fd);
+				return ARCHIVE_FATAL;
+			}
+			return res;
+		});
+	}
+	if (err) {
+		return err;
+	}
+	return open();
+}
+
+Error ReaderImpl::open_filenames(std::vector<std::string> const& filenames, size_t block_size)
+{
+	opened_ = true;
+	if (volumes_) {
+		archive_set_error(raw(), EINVAL, "volumes already opened");
+		return Error(ARCHIVE_FATAL);
+	}
+	volumes_.reset(new VolumeSet(filenames, block_size, [this]() {
+		return limited_ ? check_limits() : ARCHIVE_OK;
+	}));
+	return Error(volumes_->open(raw()));
+}
+
 Error ReaderImpl::close()
 {
 	return Error(archive_read_close(raw()));
@@ -391,7 +612,297 @@ Error ReaderImpl::next_header(Entry::ptr const& entry)
 	if (!entry_impl) {
 		return Error(ARCHIVE_FATAL);
 	}
-	return Error(archive_read_next_header2(raw(), entry_impl->raw()));
+	return Error(read_header(entry_impl->raw()));
+}
+
+int ReaderImpl::read_header(archive_entry *entry)
+{
+	if (limited_ && drain_data() != ARCHIVE_OK) {
+		return ARCHIVE_FATAL;
+	}
+
+	int res = archive_read_next_header2(raw(), entry);
+	if (res == ARCHIVE_OK || res == ARCHIVE_WARN) {
+		++key_.member;
+		key_.offset = 0;
+		block_.reset();
+		consumed_ = 0;
+		in_data_ = true;
+		drain_ = limited_ && skip_decodes(entry);
+		++entries_;
+		if (limited_ && check_limits() != ARCHIVE_OK) {
+			return ARCHIVE_FATAL;
+		}
+	}
+	return res;
+}
+
+// Whether libarchive has to decode the member's data to skip over
+// it. Behind a compression filter it does, as for the solid blocks
+// of 7-Zip, CAB and RAR, and for zip members streamed with their
+// size only given after the data. Other formats skip by offset.
+bool ReaderImpl::skip_decodes(archive_entry *entry) const
+{
+	if (archive_filter_count(raw()) > 1) {
+		return true;
+	}
+
+	switch (archive_format(raw()) & ARCHIVE_FORMAT_BASE_MASK) {
+	case ARCHIVE_FORMAT_7ZIP:
+	case ARCHIVE_FORMAT_CAB:
+	case ARCHIVE_FORMAT_RAR:
+	case ARCHIVE_FORMAT_RAR_V5:
+		return true;
+	case ARCHIVE_FORMAT_ZIP:
+		return !archive_entry_size_is_set(entry);
+	default:
+		return false;
+	}
+}
+
+int ReaderImpl::read_block(const void **buff, size_t *size, int64_t *offset)
+{
+	if (exceeded_) {
+		return ARCHIVE_FATAL;
+	}
+
+	int res = cache_
+		? read_cached_block(buff, size, offset)
+		: decode_block(buff, size, offset);
+	if (res == ARCHIVE_EOF) {
+		in_data_ = false;
+	} else if (res >= ARCHIVE_WARN && limited_) {
+		output_ += *size;
+		if (check_limits() != ARCHIVE_OK) {
+			return ARCHIVE_FATAL;
+		}
+	}
+	return res;
+}
+
+// Only what libarchive decodes counts towards the ratio, blocks
+// served from the cache were never read from this input.
+int ReaderImpl::decode_block(const void **buff, size_t *size, int64_t *offset)
+{
+	int res = archive_read_data_block(raw(), buff, size, offset);
+	if (res == ARCHIVE_OK || res == ARCHIVE_WARN) {
+		decoded_ += *size;
+	}
+	return res;
+}
+
+// When libarchive would decode the rest of the member to skip it
+// in one call, decode it here instead to check the limits after
+// every block. This bypasses the cache, libarchive has to catch up
+// after any hits all the same.
+int ReaderImpl::drain_data()
+{
+	const void *buff;
+	size_t size;
+	int64_t offset;
+
+	if (exceeded_) {
+		return ARCHIVE_FATAL;
+	}
+
+	while (in_data_ && drain_) {
+		int res = decode_block(&buff, &size, &offset);
+		if (res == ARCHIVE_EOF) {
+			in_data_ = false;
+		} else if (res < ARCHIVE_WARN) {
+			return res;
+		} else {
+			output_ += size;
+			if (check_limits() != ARCHIVE_OK) {
+				return ARCHIVE_FATAL;
+			}
+		}
+	}
+	return ARCHIVE_OK;
+}
+
+int ReaderImpl::check_limits()
+{
+	if (exceeded_) {
+		return ARCHIVE_FATAL;
+	}
+
+	const char *what = nullptr;
+	if (limits_.max_entries && entries_ > limits_.max_entries) {
+		what = "entry count";
+	} else if (limits_.max_output && output_ > limits_.max_output) {
+		what = "output size";
+	} else if (limits_.max_time.count() && std::chrono::steady_clock::now() > deadline_) {
+		what = "time";
+	} else if (limits_.max_ratio > 0 && decoded_ >= 1024 * 1024) {
+		auto input = archive_filter_bytes(raw(), -1);
+		if (input > 0 && decoded_ > limits_.max_ratio * input) {
+			what = "expansion ratio";
+		}
+	}
+
+	if (what == nullptr) {
+		return ARCHIVE_OK;
+	}
+	exceeded_ = true;
+	archive_set_error(raw(), ERANGE, "%s limit exceeded", what);
+	return ARCHIVE_FATAL;
+}
+
+void ReaderImpl::set_limits(Limits const& limits)
+{
+	limits_ = limits;
+	limited_ = limits.max_entries || limits.max_output ||
+		limits.max_ratio > 0 || limits.max_time.count();
+	deadline_ = std::chrono::steady_clock::now() + limits.max_time;
+}
+
+// key_.offset is where the caller is in the member, consumed_ is
+// where libarchive is. After a series of cache hits libarchive is
+// caught up on the first miss by dropping the blocks already served.
+int ReaderImpl::read_cached_block(const void **buff, size_t *size, int64_t *offset)
+{
+	int res = ARCHIVE_OK;
+	auto block = cache_->lookup(key_);
+	if (!block) {
+		const char *data = nullptr;
+		for (;;) {
+			res = decode_block(buff, size, offset);
+			if (res != ARCHIVE_OK && res != ARCHIVE_WARN) {
+				break;
+			}
+			data = static_cast<const char*>(*buff);
+			consumed_ = *offset + *size;
+			if (consumed_ > key_.offset) {
+				break;
+			}
+		}
+
+		if (res == ARCHIVE_EOF) {
+			data = nullptr;
+			*size = 0;
+		} else if (res < ARCHIVE_WARN) {
+			return res;
+		} else if (*offset < key_.offset) {
+			data += key_.offset - *offset;
+			*size = consumed_ - key_.offset;
+			*offset = key_.offset;
+		}
+
+		// blocks that came with a warning are cached like any other,
+		// the warning is only passed on to this reader
+		auto fresh = std::make_shared<BlockCache::Block>();
+		fresh->offset = *offset;
+		fresh->eof = res == ARCHIVE_EOF;
+		fresh->data.assign(data, data + *size);
+		cache_->insert(key_, fresh);
+		block = fresh;
+	}
+
+	block_ = block;
+	*buff = block->data.empty() ? nullptr : block->data.data();
+	*size = block->data.size();
+	*offset = block->offset;
+	if (block->eof) {
+		return ARCHIVE_EOF;
+	}
+	key_.offset = block->offset + block->data.size();
+	return res;
+}
+
+void ReaderImpl::set_block_cache(BlockCache::ptr const& cache, std::string const& archive)
+{
+	cache_ = cache;
+	key_.archive = archive;
+}
+
+Error ReaderImpl::read_data_block(const void **buff, size_t *size, int64_t *offset)
+{
+	return Error(read_block(buff, size, offset));
+}
+
+Error ReaderImpl::skip_data()
+{
+	if (limited_ && drain_) {
+		return Error(drain_data());
+	}
+	if (exceeded_) {
+		return Error(ARCHIVE_FATAL);
+	}
+	in_data_ = false;
+	return Error(archive_read_data_skip(raw()));
+}
+
+Error ReaderImpl::read_data_into_fd(int fd)
+{
+	FdSink sink(fd);
+	const void *buff;
+	size_t size;
+	int64_t offset;
+
+	for (;;) {
+		int res = read_block(&buff, &size, &offset);
+		if (res == ARCHIVE_EOF) {
+			break;
+		}
+		if (res < ARCHIVE_WARN) {
+			return Error(res);
+		}
+		if (sink.write(buff, size, offset) < 0) {
+			archive_set_error(raw(), errno, "write failed");
+			return Error(ARCHIVE_FATAL);
+		}
+	}
+
+	// at EOF offset is the entry size, which covers trailing holes
+	if (sink.finish(offset) < 0) {
+		archive_set_error(raw(), errno, "write failed");
+		return Error(ARCHIVE_FATAL);
+	}
+	return Error();
+}
+
+namespace {
+
+FileType file_type(mode_t type)
+{
+	switch (type) {
+	case AE_IFREG: return FileType::REGULAR;
+	case AE_IFDIR: return FileType::DIRECTORY;
+	case AE_IFLNK: return FileType::SYMLINK;
+	case AE_IFCHR: return FileType::CHARACTER;
+	case AE_IFBLK: return FileType::BLOCK;
+	case AE_IFIFO: return FileType::FIFO;
+	case AE_IFSOCK: return FileType::SOCKET;
+	}
+	return FileType::UNKNOWN;
+}
+
+}
+
+Error ReaderImpl::list(Manifest & manifest)
+{
+	// one entry is reused for all members, next_header skips the data
+	EntryImpl entry(raw());
+	auto e = entry.raw();
+
+	for (;;) {
+		int res = read_header(e);
+		if (res == ARCHIVE_EOF) {
+			break;
+		}
+		if (res < ARCHIVE_WARN) {
+			return Error(res);
+		}
+		manifest.append(
+			archive_entry_pathname(e),
+			archive_entry_size(e),
+			archive_entry_mtime(e),
+			archive_read_header_position(raw()),
+			archive_entry_perm(e),
+			file_type(archive_entry_filetype(e)));
+	}
+	return Error();
 }
 
 Reader::ptr Reader::create()
@@ -406,7 +917,7 @@ public:
 	Reader::ptr create_reader() const override;
 };
 
-Reader::ptr ReaderFactory::create_reader() const
+Reader::ptr ReaderFactoryImpl::create_reader() const
 {
 	return Reader::create();
 }
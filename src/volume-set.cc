@@ -0,0 +1,252 @@
+/*
+   Copyright (c) 2019 Andreas Fett. All rights reserved.
+   Use of this source code is governed by a BSD-style
+   license that can be found in the LICENSE file.
+*/
+
+#include <algorithm>
+#include <archive.h>
+#include <cassert>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "volume-set.h"
+
+namespace archivecc {
+
+VolumeSet::VolumeSet(std::vector<std::string> const& paths, size_t block_size, check_function const& check)
+:
+	buffer_(block_size),
+	window_(std::max<int64_t>(16 * block_size, 4 * 1024 * 1024)),
+	check_(check),
+	seekable_(true),
+	total_(0),
+	current_(0),
+	pos_(0)
+{
+	volumes_.reserve(paths.size());
+	for (auto const& path : paths) {
+		volumes_.push_back(Volume{path, -1, 0, -1});
+	}
+}
+
+VolumeSet::~VolumeSet()
+{
+	for (auto & vol : volumes_) {
+		close_file(vol);
+	}
+}
+
+// The volume sizes are taken up front, so that offsets can be
+// mapped to volumes and skip and seek are only offered when that
+// is possible.
+int VolumeSet::open(archive *ar)
+{
+	if (volumes_.empty()) {
+		archive_set_error(ar, EINVAL, "no volumes given");
+		return ARCHIVE_FATAL;
+	}
+
+	for (auto & vol : volumes_) {
+		struct stat st;
+		if (::stat(vol.path.c_str(), &st) != 0) {
+			archive_set_error(ar, errno, "failed to open '%s'", vol.path.c_str());
+			return ARCHIVE_FATAL;
+		}
+		vol.start = total_;
+		vol.size = S_ISREG(st.st_mode) ? st.st_size : -1;
+		if (vol.size < 0) {
+			seekable_ = false;
+		} else {
+			total_ += vol.size;
+		}
+	}
+
+	int res = enter(ar, 0, 0);
+	if (res != ARCHIVE_OK) {
+		return res;
+	}
+
+	archive_read_set_read_callback(ar, read_callback);
+	if (seekable_) {
+		archive_read_set_skip_callback(ar, skip_callback);
+		archive_read_set_seek_callback(ar, seek_callback);
+	}
+	archive_read_set_close_callback(ar, close_callback);
+	archive_read_set_callback_data(ar, this);
+	return archive_read_open1(ar);
+}
+
+// Make volume index the current one, positioned at offset within
+// it. All other volumes are closed.
+int VolumeSet::enter(archive *ar, size_t index, int64_t offset)
+{
+	for (size_t i = 0; i < volumes_.size(); ++i) {
+		if (i != index) {
+			close_file(volumes_[i]);
+		}
+	}
+
+	auto & vol = volumes_[index];
+	if (vol.fd < 0 && open_file(vol) < 0) {
+		archive_set_error(ar, errno, "failed to open '%s'", vol.path.c_str());
+		return ARCHIVE_FATAL;
+	}
+	if (seekable_ && lseek(vol.fd, offset, SEEK_SET) < 0) {
+		archive_set_error(ar, errno, "error seeking in '%s'", vol.path.c_str());
+		return ARCHIVE_FATAL;
+	}
+
+	current_ = index;
+	pos_ = vol.start + offset;
+	return ARCHIVE_OK;
+}
+
+// The last volume starting at or before offset, empty volumes are
+// passed over by the next read.
+size_t VolumeSet::locate(int64_t offset) const
+{
+	auto it = std::upper_bound(volumes_.begin(), volumes_.end(), offset,
+		[](int64_t off, Volume const& vol) { return off < vol.start; });
+	return it == volumes_.begin() ? 0 : it - volumes_.begin() - 1;
+}
+
+int VolumeSet::open_file(Volume & vol)
+{
+	vol.fd = ::open(vol.path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (vol.fd < 0) {
+		return -1;
+	}
+
+	posix_fadvise(vol.fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	return 0;
+}
+
+void VolumeSet::close_file(Volume & vol)
+{
+	if (vol.fd >= 0) {
+		::close(vol.fd);
+		vol.fd = -1;
+	}
+}
+
+// Once the rest of the current volume fits into the window, start
+// reading the head of the following volume in the background.
+void VolumeSet::prefetch()
+{
+	auto const& vol = volumes_[current_];
+	if (vol.size < 0 || vol.start + vol.size - pos_ > window_) {
+		return;
+	}
+
+	size_t next = current_ + 1;
+	if (next >= volumes_.size() || volumes_[next].fd >= 0) {
+		return;
+	}
+
+	// errors are reported when the volume is entered
+	auto & nvol = volumes_[next];
+	if (open_file(nvol) == 0) {
+		posix_fadvise(nvol.fd, 0, window_, POSIX_FADV_WILLNEED);
+	}
+}
+
+ssize_t VolumeSet::read_callback(archive *ar, void *data, const void **buff)
+{
+	auto set = static_cast<VolumeSet*>(data);
+	assert(set);
+	if (set->check_ && set->check_() != ARCHIVE_OK) {
+		return ARCHIVE_FATAL;
+	}
+
+	for (;;) {
+		auto & vol = set->volumes_[set->current_];
+		assert(vol.fd >= 0);
+		ssize_t res;
+		do {
+			res = ::read(vol.fd, set->buffer_.data(), set->buffer_.size());
+		} while (res < 0 && errno == EINTR);
+
+		if (res < 0) {
+			archive_set_error(ar, errno, "error reading '%s'", vol.path.c_str());
+			return ARCHIVE_FATAL;
+		}
+
+		if (res == 0 && set->current_ + 1 < set->volumes_.size()) {
+			int rc = set->enter(ar, set->current_ + 1, 0);
+			if (rc != ARCHIVE_OK) {
+				return rc;
+			}
+			continue;
+		}
+
+		set->pos_ += res;
+		set->prefetch();
+		*buff = set->buffer_.data();
+		return res;
+	}
+}
+
+// Skips may cross volume boundaries, but not the end of the last
+// volume.
+int64_t VolumeSet::skip_callback(archive *ar, void *data, int64_t request)
+{
+	auto set = static_cast<VolumeSet*>(data);
+	assert(set && set->seekable_);
+	int64_t target = std::min(set->pos_ + request, set->total_);
+	int64_t skip = target - set->pos_;
+	if (skip <= 0) {
+		return 0;
+	}
+
+	size_t index = set->locate(target);
+	if (set->enter(ar, index, target - set->volumes_[index].start) != ARCHIVE_OK) {
+		return ARCHIVE_FATAL;
+	}
+	set->prefetch();
+	return skip;
+}
+
+int64_t VolumeSet::seek_callback(archive *ar, void *data, int64_t offset, int whence)
+{
+	auto set = static_cast<VolumeSet*>(data);
+	assert(set && set->seekable_);
+	switch (whence) {
+	case SEEK_SET:
+		break;
+	case SEEK_CUR:
+		offset += set->pos_;
+		break;
+	case SEEK_END:
+		offset += set->total_;
+		break;
+	default:
+		archive_set_error(ar, EINVAL, "invalid seek");
+		return ARCHIVE_FATAL;
+	}
+
+	if (offset < 0) {
+		archive_set_error(ar, EINVAL, "seek before start of volumes");
+		return ARCHIVE_FATAL;
+	}
+
+	size_t index = set->locate(offset);
+	if (set->enter(ar, index, offset - set->volumes_[index].start) != ARCHIVE_OK) {
+		return ARCHIVE_FATAL;
+	}
+	return offset;
+}
+
+int VolumeSet::close_callback(archive *, void *data)
+{
+	auto set = static_cast<VolumeSet*>(data);
+	assert(set);
+	for (auto & vol : set->volumes_) {
+		close_file(vol);
+	}
+	return ARCHIVE_OK;
+}
+
+}
@@ -0,0 +1,62 @@
+/*
+   Copyright (c) 2019 Andreas Fett. All rights reserved.
+   Use of this source code is governed by a BSD-style
+   license that can be found in the LICENSE file.
+*/
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct archive;
+
+namespace archivecc {
+
+// Presents a list of files as one input stream to libarchive. A
+// single client data node is registered, moving from one volume to
+// the next happens inside the read, skip and seek callbacks. When
+// all volumes are regular files, offsets map across volumes and
+// skips and seeks are supported. The head of the next volume is
+// handed to kernel readahead while the end of the current one is
+// read. The check function is called before every read, a result
+// other than ARCHIVE_OK fails the read.
+class VolumeSet {
+public:
+	using check_function = std::function<int(void)>;
+
+	VolumeSet(std::vector<std::string> const&, size_t, check_function const& = check_function());
+	~VolumeSet();
+
+	int open(archive *);
+
+private:
+	struct Volume {
+		std::string path;
+		int fd;
+		int64_t start;
+		int64_t size;
+	};
+
+	int enter(archive *, size_t, int64_t);
+	size_t locate(int64_t) const;
+	static int open_file(Volume &);
+	static void close_file(Volume &);
+	void prefetch();
+
+	static ssize_t read_callback(archive *, void *, const void **);
+	static int64_t skip_callback(archive *, void *, int64_t);
+	static int64_t seek_callback(archive *, void *, int64_t, int);
+	static int close_callback(archive *, void *);
+
+	std::vector<Volume> volumes_;
+	std::vector<char> buffer_;
+	int64_t window_;
+	check_function check_;
+	bool seekable_;
+	int64_t total_;
+	size_t current_;
+	int64_t pos_;
+};
+
+}
@@ -0,0 +1,120 @@
+/*
+   Copyright (c) 2019 Andreas Fett. All rights reserved.
+   Use of this source code is governed by a BSD-style
+   license that can be found in the LICENSE file.
+*/
+
+// Per entry overhead of the virtual Reader against the compile time
+// configured BasicReader. Both walk the same uncompressed in-memory
+// tar of empty members, so the time is mostly header handling.
+
+#include <archivecc/basic-reader.h>
+#include <archivecc/reader.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace archivecc;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+std::vector<char> make_tar(size_t count)
+{
+	std::vector<char> out;
+	auto ar = archive_write_new();
+	archive_write_set_format_pax_restricted(ar);
+	archive_write_open(ar, &out, nullptr,
+		[](archive *, void *data, const void *buff, size_t size) -> la_ssize_t {
+			auto out = static_cast<std::vector<char>*>(data);
+			auto p = static_cast<const char*>(buff);
+			out->insert(out->end(), p, p + size);
+			return size;
+		}, nullptr);
+
+	auto entry = archive_entry_new();
+	for (size_t i = 0; i < count; ++i) {
+		archive_entry_clear(entry);
+		archive_entry_set_pathname(entry, ("dir/file" + std::to_string(i)).c_str());
+		archive_entry_set_filetype(entry, AE_IFREG);
+		archive_entry_set_perm(entry, 0644);
+		archive_entry_set_size(entry, 0);
+		archive_write_header(ar, entry);
+	}
+	archive_entry_free(entry);
+	archive_write_close(ar);
+	archive_write_free(ar);
+	return out;
+}
+
+size_t walk_virtual(std::vector<char> const& input)
+{
+	auto reader = Reader::create();
+	reader->support_format_tar();
+	reader->open_memory(input.data(), input.size());
+	auto entry = reader->create_entry();
+	size_t count = 0;
+	while (!reader->next_header(entry)) {
+		reader->skip_data();
+		++count;
+	}
+	return count;
+}
+
+size_t walk_basic(std::vector<char> const& input)
+{
+	BasicReader<source::Memory, Formats<format::Tar>> reader;
+	reader.open(source::Memory(input.data(), input.size()));
+	size_t count = 0;
+	while (!reader.next_header()) {
+		reader.skip_data();
+		++count;
+	}
+	return count;
+}
+
+template <typename Walk>
+double time_walk(Walk walk, std::vector<char> const& input, size_t expected)
+{
+	auto start = Clock::now();
+	size_t count = walk(input);
+	auto ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+	if (count != expected) {
+		fprintf(stderr, "walked %zu of %zu entries\n", count, expected);
+		return -1;
+	}
+	return ns / count;
+}
+
+}
+
+int main()
+{
+	const size_t count = 50000;
+	auto input = make_tar(count);
+
+	// alternate the readers so that drift hits both alike,
+	// keep the best round of each
+	const int rounds = 20;
+	double virt = 0;
+	double basic = 0;
+	for (int round = 0; round < rounds; ++round) {
+		double v = time_walk(walk_virtual, input, count);
+		double b = time_walk(walk_basic, input, count);
+		if (v < 0 || b < 0) {
+			return 1;
+		}
+		virt = round == 0 ? v : std::min(virt, v);
+		basic = round == 0 ? b : std::min(basic, b);
+	}
+
+	printf("%zu entries, best of %d rounds\n", count, rounds);
+	printf("Reader       %8.1f ns/entry\n", virt);
+	printf("BasicReader  %8.1f ns/entry\n", basic);
+	printf("difference   %8.1f ns/entry\n", virt - basic);
+	return 0;
+}
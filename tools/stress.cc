@@ -0,0 +1,273 @@
+/*
+   Copyright (c) 2019 Andreas Fett. All rights reserved.
+   Use of this source code is governed by a BSD-style
+   license that can be found in the LICENSE file.
+*/
+
+// Stress and fuzz driver for Reader::set_limits(). Builds adversarial
+// inputs in memory, measures throughput with and without caps and
+// exits non-zero if a cap fails to trip or trips on benign input.
+
+#include <archivecc/reader.h>
+
+#include <archive.h>
+#include <archive_entry.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace archivecc;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Member {
+	std::string name;
+	std::vector<char> data;
+	size_t repeat;
+};
+
+// writes members as tar.gz, data is written repeat times per member
+std::vector<char> make_tgz(std::vector<Member> const& members, size_t copies = 1)
+{
+	std::vector<char> out;
+	auto ar = archive_write_new();
+	archive_write_add_filter_gzip(ar);
+	archive_write_set_format_pax_restricted(ar);
+	archive_write_open(ar, &out, nullptr,
+		[](archive *, void *data, const void *buff, size_t size) -> la_ssize_t {
+			auto out = static_cast<std::vector<char>*>(data);
+			auto p = static_cast<const char*>(buff);
+			out->insert(out->end(), p, p + size);
+			return size;
+		}, nullptr);
+
+	auto entry = archive_entry_new();
+	for (size_t c = 0; c < copies; ++c) {
+		for (auto const& m : members) {
+			archive_entry_clear(entry);
+			archive_entry_set_pathname(entry, (m.name + std::to_string(c)).c_str());
+			archive_entry_set_filetype(entry, AE_IFREG);
+			archive_entry_set_perm(entry, 0644);
+			archive_entry_set_size(entry, m.data.size() * m.repeat);
+			archive_write_header(ar, entry);
+			for (size_t i = 0; i < m.repeat; ++i) {
+				archive_write_data(ar, m.data.data(), m.data.size());
+			}
+		}
+	}
+	archive_entry_free(entry);
+	archive_write_close(ar);
+	archive_write_free(ar);
+	return out;
+}
+
+struct Result {
+	Error error;
+	uint64_t entries = 0;
+	uint64_t bytes = 0;
+	double seconds = 0;
+};
+
+Reader::ptr create_reader(Reader::Limits const& limits)
+{
+	auto reader = Reader::create();
+	reader->support_filter_gzip();
+	reader->support_format_tar();
+	reader->set_limits(limits);
+	return reader;
+}
+
+Result drive(Reader::ptr const& reader, Clock::time_point start)
+{
+	Result res;
+	auto entry = reader->create_entry();
+	for (;;) {
+		res.error = reader->next_header(entry);
+		if (res.error) {
+			break;
+		}
+		++res.entries;
+
+		const void *buff;
+		size_t size;
+		int64_t offset;
+		Error err;
+		while (!(err = reader->read_data_block(&buff, &size, &offset))) {
+			res.bytes += size;
+		}
+		if (err.code() != Error::Code::AEOF) {
+			res.error = err;
+			break;
+		}
+	}
+	res.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	return res;
+}
+
+Result read_memory(std::vector<char> const& input, Reader::Limits const& limits)
+{
+	auto start = Clock::now();
+	auto reader = create_reader(limits);
+	auto err = reader->open_memory(input.data(), input.size());
+	if (err && err.code() != Error::Code::WARN) {
+		Result res;
+		res.error = err;
+		res.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+		return res;
+	}
+	return drive(reader, start);
+}
+
+// hands out the input in small chunks with a delay before each
+Result read_slow(std::vector<char> const& input, Reader::Limits const& limits)
+{
+	auto start = Clock::now();
+	auto reader = create_reader(limits);
+	size_t pos = 0;
+	reader->set_read_callback([&input, &pos](const void **buff) -> ssize_t {
+		std::this_thread::sleep_for(std::chrono::milliseconds(2));
+		size_t n = std::min<size_t>(512, input.size() - pos);
+		*buff = input.data() + pos;
+		pos += n;
+		return n;
+	});
+	auto err = reader->open();
+	if (err && err.code() != Error::Code::WARN) {
+		Result res;
+		res.error = err;
+		res.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+		return res;
+	}
+	return drive(reader, start);
+}
+
+bool tripped(Result const& res)
+{
+	return res.error.code() == Error::Code::FATAL;
+}
+
+bool clean(Result const& res)
+{
+	return res.error.code() == Error::Code::AEOF;
+}
+
+void report(const char *name, Result const& res)
+{
+	printf("%-28s %8.1f ms %10llu entries %8.1f MB/s  %s\n", name,
+		res.seconds * 1000, static_cast<unsigned long long>(res.entries),
+		res.seconds > 0 ? res.bytes / res.seconds / 1e6 : 0.0,
+		clean(res) ? "eof" : tripped(res) ? "tripped" : "error");
+}
+
+int failures = 0;
+
+void expect(bool cond, const char *what)
+{
+	if (!cond) {
+		printf("FAIL: %s\n", what);
+		++failures;
+	}
+}
+
+}
+
+int main()
+{
+	std::mt19937 rng(42);
+	std::vector<char> random(1 << 20);
+	for (auto & c : random) {
+		c = static_cast<char>(rng());
+	}
+
+	auto benign = make_tgz({ Member{"random", random, 16}, Member{"small", {'x'}, 1} }, 4);
+	auto bomb = make_tgz({ Member{"zeros", std::vector<char>(1 << 20), 256} });
+	auto many = make_tgz({ Member{"e", {}, 0} }, 100000);
+	auto small = make_tgz({ Member{"text", std::vector<char>(random.begin(), random.begin() + 3000), 1} }, 50);
+
+	// generous caps which benign input must stay below
+	Reader::Limits generous;
+	generous.max_entries = 1000;
+	generous.max_output = uint64_t(1) << 30;
+	generous.max_ratio = 100;
+	generous.max_time = std::chrono::milliseconds(10000);
+
+	printf("inputs: benign %zu, bomb %zu, many %zu bytes\n",
+		benign.size(), bomb.size(), many.size());
+
+	auto plain = read_memory(benign, Reader::Limits());
+	auto capped = read_memory(benign, generous);
+	report("benign, no caps", plain);
+	report("benign, caps", capped);
+	expect(clean(plain) && clean(capped), "benign input must read to EOF");
+	expect(capped.entries == plain.entries && capped.bytes == plain.bytes,
+		"caps must not change benign output");
+
+	Reader::Limits exact;
+	exact.max_entries = plain.entries;
+	auto at_limit = read_memory(benign, exact);
+	report("benign, entries at limit", at_limit);
+	expect(clean(at_limit), "max_entries equal to the count must reach EOF");
+
+	auto bomb_plain = read_memory(bomb, Reader::Limits());
+	report("bomb, no caps", bomb_plain);
+
+	Reader::Limits ratio;
+	ratio.max_ratio = 100;
+	auto bomb_ratio = read_memory(bomb, ratio);
+	report("bomb, ratio 100", bomb_ratio);
+	expect(tripped(bomb_ratio), "ratio cap must trip on the bomb");
+
+	Reader::Limits output;
+	output.max_output = 16 << 20;
+	auto bomb_output = read_memory(bomb, output);
+	report("bomb, output 16 MiB", bomb_output);
+	expect(tripped(bomb_output), "output cap must trip on the bomb");
+
+	auto many_plain = read_memory(many, Reader::Limits());
+	report("many entries, no caps", many_plain);
+
+	Reader::Limits entries;
+	entries.max_entries = 1000;
+	auto many_entries = read_memory(many, entries);
+	report("many entries, 1000 cap", many_entries);
+	expect(tripped(many_entries) && many_entries.entries == 1000,
+		"entry cap must trip after 1000 entries");
+
+	Reader::Limits time;
+	time.max_time = std::chrono::milliseconds(50);
+	auto slow = read_slow(benign, time);
+	report("slow source, 50 ms", slow);
+	expect(tripped(slow) && slow.seconds < 0.5, "time cap must trip on a slow source");
+
+	// flip bits in a small archive with many headers, every run has
+	// to end in bounded time with EOF or an error, never hang or crash
+	Reader::Limits fuzz = generous;
+	fuzz.max_time = std::chrono::milliseconds(1000);
+	double worst = 0;
+	size_t errors = 0;
+	const size_t runs = 200;
+	for (size_t i = 0; i < runs; ++i) {
+		auto input = small;
+		for (size_t k = 0; k < 8; ++k) {
+			input[rng() % input.size()] ^= static_cast<char>(1 << (rng() % 8));
+		}
+		auto res = read_memory(input, fuzz);
+		worst = std::max(worst, res.seconds);
+		errors += !clean(res);
+	}
+	printf("%-28s %8.1f ms worst, %zu/%zu runs failed\n", "fuzzed small", worst * 1000, errors, runs);
+	expect(worst < 2, "fuzzed input must stay within the time cap");
+
+	if (failures) {
+		printf("%d check(s) failed\n", failures);
+		return EXIT_FAILURE;
+	}
+	printf("all caps tripped\n");
+	return EXIT_SUCCESS;
+}